@@ -0,0 +1,49 @@
+//
+// Created by Alex
+//
+#include <iostream>
+#include <chrono>
+#include "jit.h"
+#ifdef REGEX_JIT_X64
+#include <x86intrin.h>
+#endif
+using namespace alex;
+
+// bytes per cycle of the table engine and the jit on a long identifier
+template <typename Fn>
+void bench(const char *name, const std::string &string, Fn fn) {
+    const int rounds = 50;
+    int symbol = 0;
+    auto start = std::chrono::steady_clock::now();
+#ifdef REGEX_JIT_X64
+    auto cycles = __rdtsc();
+#endif
+    for (int i = 0; i < rounds; ++i) {
+        // a different start each round, the call can't be hoisted out of the loop
+        symbol += fn(string.c_str() + i % 5);
+    }
+#ifdef REGEX_JIT_X64
+    cycles = __rdtsc() - cycles;
+#endif
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double bytes = (double) rounds * string.size();
+    std::cout << name << ": " << bytes / seconds / 1e6 << " MB/s";
+#ifdef REGEX_JIT_X64
+    std::cout << ", " << bytes / cycles << " bytes/cycle";
+#endif
+    std::cout << " (" << symbol << ")" << std::endl;
+}
+
+int main() {
+    std::string string(1 << 20, 'a');
+    for (size_t i = 0; i < string.size(); ++i) {
+        string[i] = "abcXYZ_019"[i % 10];
+    }
+    for (int table_limit : {4, 0}) {
+        RegexJit jit(regex_compile("[a-zA-Z_][a-zA-Z_0-9]*"), table_limit);
+        std::cout << "table_limit " << table_limit << std::endl;
+        bench("table", string, [&](const char *s) { return regex_match(jit.state_machine, s); });
+        bench("jit  ", string, [&](const char *s) { return jit.match(s); });
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+//
+// Created by Alex
+//
+
+#ifndef ALEX_LIBS_JIT_H
+#define ALEX_LIBS_JIT_H
+
+#include "regex.h"
+#include <cstdint>
+#include <type_traits>
+#include <initializer_list>
+// the code takes the string in rdi (System V ABI), Windows and Cygwin pass it in rcx
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__)) && !defined(_WIN32) && !defined(__CYGWIN__)
+#define REGEX_JIT_X64
+#include <sys/mman.h>
+#endif
+
+namespace alex {
+    // lower the state machine into x86-64 code, each state becomes a block which
+    // compares the ranges (or jumps through a table) and returns the symbol of the state
+    class RegexJit {
+    public:
+        using func_t = int (*)(const char *);
+        std::vector<std::unique_ptr<RegexState>> state_machine;
+        func_t func = nullptr; // nullptr if the code is not generated, match with the state table
+        size_t size = 0;
+        int table_limit; // the states with more ranges use a jump table
+        explicit RegexJit(std::vector<std::unique_ptr<RegexState>> machine, int table_limit = 4) :
+        state_machine(std::move(machine)), table_limit(table_limit) {
+#ifdef REGEX_JIT_X64
+            compile();
+#endif
+        }
+        RegexJit(const RegexJit &) = delete;
+        RegexJit &operator=(const RegexJit &) = delete;
+        ~RegexJit() {
+#ifdef REGEX_JIT_X64
+            if (func) {
+                munmap(reinterpret_cast<void *>(func), size);
+            }
+#endif
+        }
+        inline int match(const char *string) const {
+            return func ? func(string) : regex_match(state_machine, string);
+        }
+    private:
+        // the scratch buffers of compile()
+        struct Assembler {
+            struct Fixup {
+                int pos;
+                int label;
+                int base; // the rel32 at pos is label - base
+            };
+            std::vector<uint8_t> code;
+            std::vector<int> labels;
+            std::vector<Fixup> fixups;
+            void emit(std::initializer_list<uint8_t> bytes) {
+                code.insert(code.end(), bytes.begin(), bytes.end());
+            }
+            void emit32(int value) {
+                for (int i = 0; i < 4; ++i) {
+                    code.push_back((uint8_t) ((uint32_t) value >> (i * 8)));
+                }
+            }
+            void emit_label(int label, int base) {
+                fixups.push_back({(int) code.size(), label, base});
+                emit32(0);
+            }
+            void emit_jump(std::initializer_list<uint8_t> bytes, int label) {
+                emit(bytes);
+                emit_label(label, code.size() + 4);
+            }
+            void bind(int label) {
+                labels[label] = code.size();
+            }
+            void emit_load() {
+                // movsx/movzx ecx, byte [rdi], the same extension as char in regex_match
+                emit({0x0F, (uint8_t) (std::is_signed<char>::value ? 0xBE : 0xB6), 0x0F});
+            }
+            void resolve() {
+                for (auto &item : fixups) {
+                    int value = labels[item.label] - item.base;
+                    for (int i = 0; i < 4; ++i) {
+                        code[item.pos + i] = (uint8_t) ((uint32_t) value >> (i * 8));
+                    }
+                }
+            }
+        };
+        // labels of the state blocks
+        static inline int step_label(int state) { return state * 3; }
+        static inline int match_label(int state) { return state * 3 + 1; }
+        static inline int fail_label(int state) { return state * 3 + 2; }
+        void emit_ranges(Assembler &as, int index) {
+            const RegexTransition *dot = nullptr;
+            for (auto &item : state_machine[index]->transitions) {
+                if (item.begin == -1) {
+                    dot = &item;
+                }
+                if (item.begin > item.end) {
+                    continue;
+                }
+                if (item.begin == item.end) {
+                    as.emit({0x81, 0xF9}); // cmp ecx, begin
+                    as.emit32(item.begin);
+                    as.emit_jump({0x0F, 0x84}, step_label(item.index)); // je
+                } else {
+                    as.emit({0x8D, 0x81}); // lea eax, [rcx - begin]
+                    as.emit32(-item.begin);
+                    as.emit({0x3D}); // cmp eax, end - begin
+                    as.emit32(item.end - item.begin);
+                    as.emit_jump({0x0F, 0x86}, step_label(item.index)); // jbe
+                }
+            }
+            if (dot) {
+                as.emit_jump({0xE9}, step_label(dot->index)); // jmp
+            }
+        }
+        static void emit_table(Assembler &as, int label) {
+            as.emit({0x0F, 0xB6, 0xC1}); // movzx eax, cl
+            as.emit_jump({0x4C, 0x8D, 0x1D}, label); // lea r11, [rip + table]
+            as.emit({0x49, 0x63, 0x04, 0x83}); // movsxd rax, dword [r11 + rax * 4]
+            as.emit({0x4C, 0x01, 0xD8}); // add rax, r11
+            as.emit({0xFF, 0xE0}); // jmp rax
+        }
+        void compile() {
+            Assembler as;
+            int count = state_machine.size();
+            std::vector<std::pair<int, int>> tables;
+            as.labels.assign(count * 3, -1);
+            as.emit_load();
+            as.emit_jump({0xE9}, match_label(0));
+            for (int i = 0; i < count; ++i) {
+                as.bind(step_label(i));
+                as.emit({0x48, 0xFF, 0xC7}); // inc rdi
+                as.emit_load();
+                as.emit({0x85, 0xC9}); // test ecx, ecx
+                as.emit_jump({0x0F, 0x84}, fail_label(i)); // je
+                as.bind(match_label(i));
+                if ((int) state_machine[i]->transitions.size() > table_limit) {
+                    tables.emplace_back(i, as.labels.size());
+                    as.labels.push_back(-1);
+                    emit_table(as, tables.back().second);
+                } else {
+                    emit_ranges(as, i);
+                }
+                as.bind(fail_label(i));
+                as.emit({0xB8}); // mov eax, symbol
+                as.emit32(state_machine[i]->symbol);
+                as.emit({0xC3}); // ret
+            }
+            while (as.code.size() % 4) {
+                as.emit({0xCC});
+            }
+            for (auto &table : tables) {
+                auto *state = state_machine[table.first].get();
+                int base = as.code.size();
+                as.bind(table.second);
+                for (int chr = 0; chr < 256; ++chr) {
+                    auto *trans = state->find_trans(std::is_signed<char>::value ? (int) (signed char) chr : chr);
+                    as.emit_label(trans ? step_label(trans->index) : fail_label(table.first), base);
+                }
+            }
+            as.resolve();
+#ifdef REGEX_JIT_X64
+            void *memory = mmap(nullptr, as.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                return;
+            }
+            memcpy(memory, as.code.data(), as.code.size());
+            if (mprotect(memory, as.code.size(), PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, as.code.size());
+                return;
+            }
+            size = as.code.size();
+            func = reinterpret_cast<func_t>(memory);
+#endif
+        }
+    };
+}
+
+#endif //ALEX_LIBS_JIT_H
@@ -38,6 +38,9 @@ namespace alex {
         void generate_states() {
             state_machine = std::move(generator.generate());
         }
+        void generate_states(int threads) {
+            state_machine = std::move(generator.generate(threads));
+        }
         void reset(iter_t begin) {
             reset(begin, begin + strlen(begin));
         }
@@ -13,6 +13,11 @@
 #include <tuple>
 #include <string>
 #include <string.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 #define RegexNodeDecl() int accept(RegexVisitor *) override;
 #define RegexNodeList(V) \
@@ -23,7 +28,8 @@
             V(RegexPlus) \
             V(RegexRepeat) \
             V(RegexQuestion) \
-            V(RegexStar)
+            V(RegexStar) \
+            V(RegexGroup)
 namespace alex {
     class RegexVisitor;
     class RegexNode {
@@ -32,6 +38,9 @@ namespace alex {
         std::vector<int> firstpos;
         std::vector<int> lastpos;
         std::vector<int> followpos;
+        std::map<int, std::vector<int>> firsttags; // tags set before entering the position of firstpos
+        std::map<int, std::vector<int>> lasttags; // tags set after leaving the position of lastpos
+        std::vector<int> nulltags; // tags set when the node matches the empty string
         inline void set_index(int idx) { this->index = idx; }
         inline int get_index(int idx) const { return this->index; }
         virtual ~RegexNode() = default;
@@ -98,7 +107,7 @@ namespace alex {
             std::cout << "|";
             rhs->print();
         }
-        bool nullable() override { return rhs->nullable() || rhs->nullable(); }
+        bool nullable() override { return lhs->nullable() || rhs->nullable(); }
     };
     class RegexRange : public RegexNode {
     public:
@@ -108,6 +117,10 @@ namespace alex {
         int begin;
         int end;
         int symbol = -1;
+        int tags = 0; // tag count of the pattern
+        int registers = 0; // first register of the tags
+        std::map<int, std::vector<int>> followtags; // tags set between the leaf and the position of followpos
+        std::vector<int> finaltags; // tags set when the pattern is accepted after the leaf
     };
     class RegexStar : public RegexNode {
     public:
@@ -150,6 +163,19 @@ namespace alex {
         }
         bool nullable() override { return begin == 0; }
     };
+    class RegexGroup : public RegexNode {
+    public:
+        RegexNodeDecl();
+        std::shared_ptr <RegexNode> node;
+        int group = -1; // capture tags are group * 2 and group * 2 + 1
+        RegexGroup(std::shared_ptr <RegexNode> node) : node(std::move(node)) {}
+        void print() override {
+            std::cout << "(";
+            node->print();
+            std::cout << ")";
+        }
+        bool nullable() override { return node->nullable(); }
+    };
     class RegexVisitor {
     public:
 #define DefineVisitor(Type) virtual int visit(Type *node) { return node->accept(this); }
@@ -160,18 +186,26 @@ namespace alex {
     RegexNodeList(DefineVisitor)
 #undef  DefineVisitor
     class RegexState;
+    struct RegexTagOp {
+        int dst;
+        int src; // -1 to store the offset after the character
+    };
     struct RegexTransition {
         RegexState *state = nullptr;
         int index = -1;
         int begin;
         int end;
+        std::vector<RegexTagOp> tags; // run on the registers when the transition is taken
         RegexTransition(RegexState *state, int index, int begin, int end) :
         state(state), index(index), begin(begin), end(end) {}
         RegexTransition(int begin, int end) : begin(begin), end(end) {}
     };
     struct RegexState {
         int symbol = -1;
+        int groups = 0; // capture groups of the symbol, spans are in the registers [0, groups * 2)
+        int registers = 0; // only on the initial state
         bool visited = false;
+        std::vector<RegexTagOp> tags; // only on the initial state, run before the first character
         std::vector<RegexTransition> transitions;
         std::vector<int> go_to; // list index of the leaf
         inline const RegexTransition *find_trans(const int chr) const {
@@ -192,20 +226,38 @@ namespace alex {
         int index = 0;
         int visit_count = 0;
         int symbol_count = 0;
+        int group_count = 0; // capture groups of the feeding pattern
+        int register_count = 0;
+        bool exact = false; // the states of the capture groups are matched by the exact position set
+        std::vector<int> groups; // capture groups of each symbol
         std::vector<int> firstpos; // all first pos
+        std::map<int, std::vector<int>> firsttags;
         std::vector<RegexRange *> lists; // record all of the leaf node
+        std::vector<std::shared_ptr<RegexNode>> nodes; // the fed patterns, keep the leaves of lists alive
         std::vector<std::unique_ptr<RegexState>> states;
         RegexGenerator() = default;
         int feed(std::shared_ptr<RegexNode> node) {
+            int first = index;
+            group_count = 0;
+            nodes.push_back(node);
             node->accept(this);
             firstpos.insert(firstpos.end(), node->firstpos.begin(), node->firstpos.end());
+            firsttags.insert(node->firsttags.begin(), node->firsttags.end());
             for (auto &item : node->lastpos) {
                 lists[item]->symbol = symbol_count;
+                auto tags = node->lasttags.find(item);
+                if (tags != node->lasttags.end()) {
+                    lists[item]->finaltags = tags->second;
+                }
+            }
+            for (int i = first; i < index; ++i) {
+                lists[i]->tags = group_count * 2;
             }
+            groups.push_back(group_count);
             return symbol_count++;
         }
         std::vector<std::unique_ptr<RegexState>> generate() {
-            get_goto_state(firstpos);
+            generate_start();
             while (visit_count < states.size()) {
                 if (!states[visit_count]->visited) {
                     generate_transition(states[visit_count].get());
@@ -214,8 +266,102 @@ namespace alex {
             }
             return std::move(states);
         }
+        // expand the states level by level with `threads` workers, the workers only look up the states
+        // of the previous levels and the new states are appended in the same order as generate() does,
+        // so the state numbering is the same as the sequential build
+        std::vector<std::unique_ptr<RegexState>> generate(int threads) {
+            if (threads <= 1) {
+                return generate();
+            }
+            generate_start();
+            // the workers are started once and woken up for each level
+            std::mutex mutex;
+            std::condition_variable wake, done;
+            int level = 0;
+            int running = 0;
+            bool stop = false;
+            int first = 0;
+            int frontier = 0;
+            std::atomic<int> next(0);
+            std::vector<std::vector<RegexGoto>> gotos;
+            auto expand = [&]() {
+                for (int i = next++; i < frontier; i = next++) {
+                    collect_transition(states[i].get(), gotos[i - first], frontier);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (int i = 1; i < threads; ++i) {
+                workers.emplace_back([&]() {
+                    int seen = 0;
+                    while (true) {
+                        {
+                            std::unique_lock<std::mutex> lock(mutex);
+                            wake.wait(lock, [&]() { return stop || level != seen; });
+                            if (stop) {
+                                return;
+                            }
+                            seen = level;
+                        }
+                        expand();
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (--running == 0) {
+                            done.notify_one();
+                        }
+                    }
+                });
+            }
+            while (visit_count < states.size()) {
+                first = visit_count;
+                frontier = states.size();
+                gotos.assign(frontier - first, std::vector<RegexGoto>());
+                next = first;
+                if (frontier - first > 1) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        running = workers.size();
+                        ++level;
+                    }
+                    wake.notify_all();
+                    expand();
+                    std::unique_lock<std::mutex> lock(mutex);
+                    done.wait(lock, [&]() { return running == 0; });
+                } else {
+                    expand();
+                }
+                for (int i = first; i < frontier; ++i) {
+                    auto *state = states[i].get();
+                    state->visited = true;
+                    for (auto &item : gotos[i - first]) {
+                        int idx = item.index;
+                        if (idx < 0) {
+                            idx = get_goto_state(item.go_to, item.symbol, frontier);
+                        }
+                        state->transitions.push_back({states[idx].get(), idx, item.begin, item.end});
+                        state->transitions.back().tags = std::move(item.tags);
+                    }
+                }
+                visit_count = frontier;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake.notify_all();
+            for (auto &item : workers) {
+                item.join();
+            }
+            return std::move(states);
+        }
     private:
-        static bool contains(std::vector<int> vec, int value) {
+        struct RegexGoto {
+            std::vector<int> go_to;
+            int symbol = -1;
+            int index = -1; // -1 if the state is not found in the previous levels
+            int begin;
+            int end;
+            std::vector<RegexTagOp> tags;
+        };
+        static bool contains(const std::vector<int> &vec, int value) {
             for (auto &item : vec) {
                 if (item == value) {
                     return true;
@@ -223,7 +369,7 @@ namespace alex {
             }
             return false;
         }
-        bool is_same(std::vector<int> &lhs, std::vector<int> &rhs) {
+        static bool is_same(const std::vector<int> &lhs, const std::vector<int> &rhs) {
             for (auto &slice : rhs) {
                 if (!contains(lhs, slice)) {
                     return false;
@@ -234,28 +380,44 @@ namespace alex {
             }
             return true;
         }
-        int get_goto_state(std::vector<int> &go_to, int symbol = -1) {
-            //int symbol = get_symbol(go_to);
-            for (int i = 0; i < states.size(); ++i) {
+        // is_same also accepts a state with more positions, those positions would run the tag
+        // operations of the paths which are not taken, so they are only allowed without capture groups.
+        // with capture groups the order of go_to is the priority of the positions and must be the same
+        int find_goto_state(const std::vector<int> &go_to, int symbol, int begin, int end) const {
+            for (int i = begin; i < end; ++i) {
+                if (exact && states[i]->go_to != go_to) {
+                    continue;
+                }
                 if (is_same(states[i]->go_to, go_to) && symbol == states[i]->symbol) {
                     return i;
                 }
             }
+            return -1;
+        }
+        int get_goto_state(std::vector<int> &go_to, int symbol = -1, int begin = 0) {
+            //int symbol = get_symbol(go_to);
+            int idx = find_goto_state(go_to, symbol, begin, states.size());
+            if (idx >= 0) {
+                return idx;
+            }
             auto *state = new RegexState;
             state->symbol = symbol;
+            state->groups = symbol >= 0 ? groups[symbol] : 0;
             state->go_to = go_to;
             states.emplace_back(state);
             return states.size() - 1;
         }
-        void insert_goto(RegexState *state, char begin, char end) {
-            std::vector<int> go_to;
+        // the positions of go_to are visited in priority order and a new position takes the registers of
+        // the first leaf reaching it, so the spans are the leftmost-greedy (perl) ones of the longest match
+        void collect_goto(const RegexState *state, char begin, char end,
+                          std::vector<int> &go_to, int &symbol, std::vector<RegexTagOp> &tags) const {
             std::vector<int> matched;
-            int symbol = -1;
             for (auto &id : state->go_to) {
-                if (begin >= lists[id]->begin && end <= lists[id]->end) {
+                if (in_range(lists[id], begin, end)) {
                     for (auto &item : lists[id]->followpos) {
                         if (!contains(go_to, item)) {
                             go_to.push_back(item);
+                            insert_tags(tags, lists[id], item);
                         }
                     }
                     if (begin == lists[id]->begin && end == lists[id]->end && lists[id]->symbol != -1)
@@ -270,14 +432,50 @@ namespace alex {
                     symbol = lists[item]->symbol;
                 }
             }
+            if (symbol == -1) {
+                return;
+            }
+            // the spans come from the first leaf accepting the symbol
+            for (auto &id : state->go_to) {
+                auto *leaf = lists[id];
+                if (in_range(leaf, begin, end) && leaf->symbol == symbol) {
+                    for (int tag = 0; tag < leaf->tags; ++tag) {
+                        tags.push_back({tag, contains(leaf->finaltags, tag) ? -1 : leaf->registers + tag});
+                    }
+                    break;
+                }
+            }
+        }
+        // without capture groups '.' is only taken when no other range matches, with capture groups it
+        // matches any character like in perl, so the spans don't depend on the other ranges of the state
+        inline bool in_range(const RegexRange *leaf, int begin, int end) const {
+            return (begin >= leaf->begin && end <= leaf->end) || (exact && leaf->begin == -1);
+        }
+        // the tags of the position `pos` are copied from the leaf, except the ones set between them
+        void insert_tags(std::vector<RegexTagOp> &tags, const RegexRange *leaf, int pos) const {
+            if (leaf->tags == 0) {
+                return;
+            }
+            auto follow = leaf->followtags.find(pos);
+            for (int tag = 0; tag < leaf->tags; ++tag) {
+                bool set = follow != leaf->followtags.end() && contains(follow->second, tag);
+                tags.push_back({lists[pos]->registers + tag, set ? -1 : leaf->registers + tag});
+            }
+        }
+        void insert_goto(RegexState *state, char begin, char end) {
+            std::vector<int> go_to;
+            std::vector<RegexTagOp> tags;
+            int symbol = -1;
+            collect_goto(state, begin, end, go_to, symbol, tags);
             auto idx = get_goto_state(go_to, symbol);
             if (idx >= 0) {
                 auto *goto_state = states[idx].get();
                 state->transitions.push_back({goto_state, idx, begin, end});
+                state->transitions.back().tags = std::move(tags);
             }
         }
-        void generate_transition(RegexState *state) {
-            state->visited = true;
+        template <typename Fn>
+        void split_ranges(const RegexState *state, Fn fn) const {
             std::map<int, int> bounds;
             for (auto &id : state->go_to) { // 将go_to相同的状态合并 之后生成新go_to
                 bounds.insert(std::pair<int, int>(lists[id]->begin, 1));
@@ -294,36 +492,119 @@ namespace alex {
                     continue;
                 }
                 int end = (iter)->first - 1;
+                fn(begin, end);
+            }
+        }
+        // registers [0, max groups * 2) hold the spans of the accepted symbol,
+        // followed by the tags of each leaf
+        void generate_start() {
+            int final_count = 0;
+            for (auto &item : groups) {
+                final_count = std::max(final_count, item * 2);
+            }
+            register_count = final_count;
+            exact = final_count > 0;
+            for (auto &leaf : lists) {
+                leaf->registers = register_count;
+                register_count += leaf->tags;
+            }
+            get_goto_state(firstpos);
+            auto *state = states[0].get();
+            state->registers = register_count;
+            for (auto &item : firsttags) {
+                for (auto &tag : item.second) {
+                    state->tags.push_back({lists[item.first]->registers + tag, -1});
+                }
+            }
+        }
+        void generate_transition(RegexState *state) {
+            state->visited = true;
+            split_ranges(state, [&](int begin, int end) {
                 insert_goto(state, begin, end);
+            });
+        }
+        // run by the workers of generate(threads), only the states before `frontier` are read
+        void collect_transition(const RegexState *state, std::vector<RegexGoto> &gotos, int frontier) const {
+            split_ranges(state, [&](int begin, int end) {
+                gotos.emplace_back();
+                auto &item = gotos.back();
+                item.begin = (char) begin;
+                item.end = (char) end;
+                collect_goto(state, begin, end, item.go_to, item.symbol, item.tags);
+                item.index = find_goto_state(item.go_to, item.symbol, 0, frontier);
+            });
+        }
+        // `skipped` are the tags of the nullable nodes between `from` and `to`. followpos is kept in the
+        // priority order: the inner nodes are visited first, so a loop continues before it exits and
+        // a nullable node is entered before it is skipped. only the first edge to a position is kept
+        void add_follow(RegexNode *from, RegexNode *to, const std::vector<int> &skipped = {}) {
+            for (auto &item : from->lastpos) {
+                auto *leaf = lists[item];
+                auto last = from->lasttags.find(item);
+                for (auto &pos : to->firstpos) {
+                    if (contains(leaf->followpos, pos)) {
+                        continue;
+                    }
+                    leaf->followpos.push_back(pos);
+                    auto first = to->firsttags.find(pos);
+                    if (last == from->lasttags.end() && first == to->firsttags.end() && skipped.empty()) {
+                        continue;
+                    }
+                    auto &tags = leaf->followtags[pos];
+                    if (last != from->lasttags.end()) {
+                        tags.insert(tags.end(), last->second.begin(), last->second.end());
+                    }
+                    tags.insert(tags.end(), skipped.begin(), skipped.end());
+                    if (first != to->firsttags.end()) {
+                        tags.insert(tags.end(), first->second.begin(), first->second.end());
+                    }
+                }
             }
         }
-        void add_follow(std::vector<int> &elements, std::vector<int> &follow) {
-            for (auto &item : elements) {
-                lists[item]->followpos.insert(lists[item]->followpos.end(), follow.begin(), follow.end());
+        // also used for the loops with a nullable body, a greedy loop makes an empty iteration before it exits
+        static void add_tags(std::map<int, std::vector<int>> &tags, std::vector<int> &positions, std::vector<int> &skipped) {
+            if (skipped.empty()) {
+                return;
+            }
+            for (auto &item : positions) {
+                tags[item].insert(tags[item].end(), skipped.begin(), skipped.end());
             }
         }
         int visit(RegexConcat *node) override {
+            std::vector<int> skipped;
             for (auto &item : node->nodes) {
                 item->accept(this);
             }
             for (auto &item : node->nodes) {
                 node->firstpos.insert(node->firstpos.end(), item->firstpos.begin(), item->firstpos.end());
+                node->firsttags.insert(item->firsttags.begin(), item->firsttags.end());
+                add_tags(node->firsttags, item->firstpos, skipped);
                 if (!item->nullable()) {
                     break;
                 }
+                skipped.insert(skipped.end(), item->nulltags.begin(), item->nulltags.end());
+            }
+            if (node->nullable()) {
+                node->nulltags = skipped;
             }
+            skipped.clear();
             for (auto iter = node->nodes.rbegin();iter != node->nodes.rend();++iter) {
                 node->lastpos.insert(node->lastpos.end(), (*iter)->lastpos.begin(), (*iter)->lastpos.end());
+                node->lasttags.insert((*iter)->lasttags.begin(), (*iter)->lasttags.end());
+                add_tags(node->lasttags, (*iter)->lastpos, skipped);
                 if (!(*iter)->nullable()) {
                     break;
                 }
+                skipped.insert(skipped.end(), (*iter)->nulltags.begin(), (*iter)->nulltags.end());
             }
             for (int i = 1; i < node->nodes.size(); ++i) {
+                skipped.clear();
                 for (int j = i; j < node->nodes.size(); ++j) {
-                    add_follow(node->nodes[i - 1]->lastpos, node->nodes[j]->firstpos);
+                    add_follow(node->nodes[i - 1].get(), node->nodes[j].get(), skipped);
                     if (!node->nodes[j]->nullable()) {
                         break;
                     }
+                    skipped.insert(skipped.end(), node->nodes[j]->nulltags.begin(), node->nodes[j]->nulltags.end());
                 }
                 //add_follow(node->nodes[i - 1]->lastpos, node->nodes[i]->firstpos);
             }
@@ -352,33 +633,76 @@ namespace alex {
             node->firstpos.insert(node->firstpos.end(), node->rhs->firstpos.begin(), node->rhs->firstpos.end());
             node->lastpos.insert(node->lastpos.end(), node->lhs->lastpos.begin(), node->lhs->lastpos.end());
             node->lastpos.insert(node->lastpos.end(), node->rhs->lastpos.begin(), node->rhs->lastpos.end());
+            node->firsttags.insert(node->lhs->firsttags.begin(), node->lhs->firsttags.end());
+            node->firsttags.insert(node->rhs->firsttags.begin(), node->rhs->firsttags.end());
+            node->lasttags.insert(node->lhs->lasttags.begin(), node->lhs->lasttags.end());
+            node->lasttags.insert(node->rhs->lasttags.begin(), node->rhs->lasttags.end());
+            if (node->nullable()) {
+                node->nulltags = node->lhs->nullable() ? node->lhs->nulltags : node->rhs->nulltags;
+            }
             return 0;
         }
         int visit(RegexPlus *node) override {
             node->node->accept(this);
             node->firstpos = node->node->firstpos;
             node->lastpos = node->node->lastpos;
-            add_follow(node->node->lastpos, node->node->firstpos);
+            node->firsttags = node->node->firsttags;
+            node->lasttags = node->node->lasttags;
+            node->nulltags = node->node->nulltags;
+            add_follow(node->node.get(), node->node.get());
+            add_tags(node->lasttags, node->lastpos, node->node->nulltags);
             return 0;
         }
         int visit(RegexStar *node) override {
             node->node->accept(this);
             node->firstpos = node->node->firstpos;
             node->lastpos = node->node->lastpos;
-            add_follow(node->node->lastpos, node->node->firstpos);
+            node->firsttags = node->node->firsttags;
+            node->lasttags = node->node->lasttags;
+            node->nulltags = node->node->nulltags;
+            add_follow(node->node.get(), node->node.get());
+            add_tags(node->lasttags, node->lastpos, node->node->nulltags);
             return 0;
         }
         int visit(RegexRepeat *node) override {
             node->node->accept(this);
             node->firstpos = node->node->firstpos;
             node->lastpos = node->node->lastpos;
-            add_follow(node->node->lastpos, node->node->firstpos);
+            node->firsttags = node->node->firsttags;
+            node->lasttags = node->node->lasttags;
+            node->nulltags = node->node->nulltags;
+            add_follow(node->node.get(), node->node.get());
+            add_tags(node->lasttags, node->lastpos, node->node->nulltags);
             return 0;
         }
         int visit(RegexQuestion *node) override {
             node->node->accept(this);
             node->firstpos = node->node->firstpos;
             node->lastpos = node->node->lastpos;
+            node->firsttags = node->node->firsttags;
+            node->lasttags = node->node->lasttags;
+            node->nulltags = node->node->nulltags;
+            return 0;
+        }
+        int visit(RegexGroup *node) override {
+            node->group = group_count++;
+            node->node->accept(this);
+            node->firstpos = node->node->firstpos;
+            node->lastpos = node->node->lastpos;
+            node->firsttags = node->node->firsttags;
+            node->lasttags = node->node->lasttags;
+            for (auto &item : node->firstpos) {
+                auto &tags = node->firsttags[item];
+                tags.insert(tags.begin(), node->group * 2);
+            }
+            for (auto &item : node->lastpos) {
+                node->lasttags[item].push_back(node->group * 2 + 1);
+            }
+            if (node->nullable()) {
+                node->nulltags = node->node->nulltags;
+                node->nulltags.push_back(node->group * 2);
+                node->nulltags.push_back(node->group * 2 + 1);
+            }
             return 0;
         }
     };
@@ -480,7 +804,12 @@ namespace alex {
             switch(*m_current) {
                 case '(':
                     m_current++;
-                    node = parse_concat();
+                    if (m_current + 1 < m_last && m_current[0] == '?' && m_current[1] == ':') {
+                        m_current += 2;
+                        node = parse_concat();
+                    } else {
+                        node = std::make_shared<RegexGroup>(parse_concat());
+                    }
                     break;
                 case '[':
                     m_current++;
@@ -565,6 +894,42 @@ namespace alex {
         } while (*string != '\0');
         return state->symbol;
     }
+    struct RegexSpan {
+        int begin = -1;
+        int end = -1;
+    };
+    // spans[0] is the whole match and spans[i] is the i-th capture group, -1 if the group is not matched.
+    // the match is the longest one and its groups are split leftmost-greedy like perl
+    template <typename It>
+    int regex_match(const std::vector<std::unique_ptr<RegexState>> &state_machine, It string, std::vector<RegexSpan> &spans) {
+        auto *state = state_machine[0].get();
+        std::vector<int> registers(state->registers, -1);
+        std::vector<int> next(state->registers, -1);
+        int offset = 0;
+        for (auto &op : state->tags) {
+            registers[op.dst] = offset;
+        }
+        do {
+            auto *trans = state->find_trans(*(string));
+            if (trans == nullptr) {
+                break;
+            }
+            ++offset;
+            for (auto &op : trans->tags) {
+                next[op.dst] = op.src < 0 ? offset : registers[op.src];
+            }
+            registers.swap(next);
+            state = trans->state;
+        } while (*++string != '\0');
+        spans.assign(state->groups + 1, RegexSpan());
+        if (state->symbol != -1) {
+            spans[0] = {0, offset};
+            for (int i = 0; i < state->groups; ++i) {
+                spans[i + 1] = {registers[i * 2], registers[i * 2 + 1]};
+            }
+        }
+        return state->symbol;
+    }
     std::string regex_emit_c(const std::vector<std::unique_ptr<RegexState>> &state_machine) {
         std::string result;
         result.append("int GetNextToken() {\n");
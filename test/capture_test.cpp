@@ -0,0 +1,81 @@
+//
+// Created by Alex
+//
+#include "test.h"
+#include "regex.h"
+using namespace alex;
+
+// the spans of the groups as "begin,end;" after the matched symbol
+std::string capture(const std::vector<std::unique_ptr<RegexState>> &state_machine, const char *string) {
+    std::vector<RegexSpan> spans;
+    std::string result = std::to_string(regex_match(state_machine, string, spans));
+    for (auto &item : spans) {
+        result += " " + std::to_string(item.begin) + "," + std::to_string(item.end);
+    }
+    return result;
+}
+
+std::string capture(const char *regex, const char *string) {
+    auto node = RegexParser(regex).parse_concat();
+    RegexGenerator generator;
+    generator.feed(node);
+    return capture(generator.generate(), string);
+}
+
+int main() {
+    CHECK(capture("id=([0-9]+)", "id=1234") == "0 0,7 3,7");
+    CHECK(capture("([a-z]+)=([0-9]+)", "key=42") == "0 0,6 0,3 4,6");
+    CHECK(capture("(([0-9]+)\\.([0-9]+))", "12.5") == "0 0,4 0,4 0,2 3,4");
+    CHECK(capture("'(.*)'", "'asdf'") == "0 0,6 1,5");
+    CHECK(capture("[0-9]+", "1234") == "0 0,4");
+    CHECK(capture("[0-9]+", "x") == "-1 -1,-1");
+    // alternation
+    CHECK(capture("(a|b)+c", "abbac") == "0 0,5 3,4");
+    CHECK(capture("(abc|d)e", "de") == "0 0,2 0,1");
+    // repeated groups keep the last iteration
+    CHECK(capture("((a)|b)+", "ab") == "0 0,2 1,2 0,1");
+    CHECK(capture("(a)*b", "aab") == "0 0,3 1,2");
+    CHECK(capture("(a)*b", "b") == "0 0,1 -1,-1");
+    // optional and nullable groups
+    CHECK(capture("x(y)?z", "xz") == "0 0,2 -1,-1");
+    CHECK(capture("x(y)?z", "xyz") == "0 0,3 1,2");
+    CHECK(capture("([a-z]+)=([0-9]*)", "a=") == "0 0,2 0,1 2,2");
+    CHECK(capture("([a-z]+)=([0-9]*)", "a=12") == "0 0,4 0,1 2,4");
+    CHECK(capture("(a*)b", "b") == "0 0,1 0,0");
+    CHECK(capture("(a?)b", "b") == "0 0,1 0,0");
+    CHECK(capture("x(a*)(b*)y", "xy") == "0 0,2 1,1 1,1");
+    CHECK(capture("x(a*)(b*)y", "xby") == "0 0,3 1,1 1,2");
+    CHECK(capture("((a*)|c)d", "d") == "0 0,1 0,0 0,0");
+    // a state must not carry the registers of the positions which are not reached
+    CHECK(capture("([a-c]*)([c-e]+)", "becc") == "0 0,4 0,1 1,4");
+    CHECK(capture("([a-c]*)([c-e]+)", "abc") == "0 0,3 0,2 2,3");
+    // ambiguous splits take the leftmost-greedy (perl) spans
+    CHECK(capture("(.*)=(.*)", "a=b=c") == "0 0,5 0,3 4,5");
+    CHECK(capture("(.*),(.*)", "a,b,c") == "0 0,5 0,3 4,5");
+    CHECK(capture("(a*)(a*)", "aa") == "0 0,2 0,2 2,2");
+    CHECK(capture("(a+)(a*)", "aaa") == "0 0,3 0,3 3,3");
+    CHECK(capture("(ab|a)(bc|c)", "abc") == "0 0,3 0,2 2,3");
+    CHECK(capture("(a|ab)(c|bcd)(d*)", "abcd") == "0 0,4 0,1 1,4 4,4");
+    CHECK(capture("(a*)+b", "aab") == "0 0,3 2,2");
+    CHECK(capture("(a*)*b", "b") == "0 0,1 0,0");
+    CHECK(capture("(.)(.*)(.)", "abcd") == "0 0,4 0,1 1,3 3,4");
+    // non-capturing groups
+    CHECK(capture("(?:ab)+(c)", "ababc") == "0 0,5 4,5");
+    CHECK(capture("(?:a|b)(?:c)", "bc") == "0 0,2");
+    // the groups are numbered per pattern in a multi-pattern machine
+    {
+        RegexGenerator generator;
+        auto keyword = RegexParser("if").parse_concat();
+        auto pair = RegexParser("([a-z]+)=([0-9]+)").parse_concat();
+        auto number = RegexParser("(?:0x)?([0-9]+)").parse_concat();
+        generator.feed(keyword);
+        generator.feed(pair);
+        generator.feed(number);
+        auto state_machine = generator.generate();
+        CHECK(capture(state_machine, "if") == "0 0,2");
+        CHECK(capture(state_machine, "ab=12") == "1 0,5 0,2 3,5");
+        CHECK(capture(state_machine, "0x42") == "2 0,4 2,4");
+        CHECK(capture(state_machine, "42") == "2 0,2 0,2");
+    }
+    return test_failures != 0;
+}
@@ -0,0 +1,48 @@
+//
+// Created by Alex
+//
+#include "test.h"
+#include "regex.h"
+using namespace alex;
+
+std::string dump(const std::vector<std::unique_ptr<RegexState>> &state_machine) {
+    std::string result;
+    for (auto &state : state_machine) {
+        result += std::to_string(state->symbol) + ":";
+        for (auto &item : state->transitions) {
+            result += std::to_string(item.index) + "," + std::to_string(item.begin) + "," + std::to_string(item.end) + "[";
+            for (auto &op : item.tags) {
+                result += std::to_string(op.dst) + "<" + std::to_string(op.src) + " ";
+            }
+            result += "];";
+        }
+        result += "\n";
+    }
+    return result;
+}
+
+std::string generate(const std::vector<std::string> &patterns, int threads) {
+    RegexGenerator generator;
+    for (auto &item : patterns) {
+        generator.feed(RegexParser(item.c_str()).parse_concat());
+    }
+    return dump(generator.generate(threads));
+}
+
+int main() {
+    std::vector<std::string> patterns;
+    for (int i = 0; i < 300; ++i) {
+        patterns.push_back("k" + std::to_string(i * 7919 % 100000) + "(?:ab|cd)*[a-z]+x" + std::to_string(i % 13) + "[0-9]?");
+    }
+    patterns.emplace_back("[0-9]+");
+    patterns.emplace_back("'.*'");
+    patterns.emplace_back("[a-zA-Z_][a-zA-Z_0-9]*");
+    auto expected = generate(patterns, 1);
+    for (int threads : {2, 3, 8}) {
+        CHECK(generate(patterns, threads) == expected);
+    }
+    patterns.emplace_back("([a-z]+)=([0-9]*)");
+    expected = generate(patterns, 1);
+    CHECK(generate(patterns, 4) == expected);
+    return test_failures != 0;
+}
@@ -0,0 +1,35 @@
+//
+// Created by Alex
+//
+#include <random>
+#include "test.h"
+#include "jit.h"
+using namespace alex;
+
+const char *patterns[] = {
+        "[0-9]+", "[a-z]+", "'.*'", "aa[a-z]+", "[a-zA-Z_][a-zA-Z_0-9]*", "(ab|cd)*e?f+", "x.y", "[\\x80-\\xfe]+z",
+        "if|else|while|for|return|[a-z]+|[0-9]+|[ \\t\\n]+|==|=|<=|<|>",
+};
+
+int main() {
+    std::mt19937 random(1);
+    const char alphabet[] = "abcdefxyz019_'AZ \t\n=<>\x80\xfe\xff.";
+    for (auto pattern : patterns) {
+        // 0 lowers every state to a jump table, 256 lowers every state to range compares
+        for (int table_limit : {0, 4, 256}) {
+            RegexJit jit(regex_compile(pattern), table_limit);
+#ifdef REGEX_JIT_X64
+            CHECK(jit.func != nullptr);
+#endif
+            for (int n = 0; n < 20000; ++n) {
+                std::string string;
+                int length = 1 + random() % 12;
+                for (int i = 0; i < length; ++i) {
+                    string += alphabet[random() % (sizeof(alphabet) - 1)];
+                }
+                CHECK(jit.match(string.c_str()) == regex_match(jit.state_machine, string.c_str()));
+            }
+        }
+    }
+    return test_failures != 0;
+}
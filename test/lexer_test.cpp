@@ -0,0 +1,31 @@
+//
+// Created by Alex
+//
+#include "test.h"
+#include "lexer.h"
+using namespace alex;
+
+// the symbols and lexemes of the tokens as "symbol:lexeme "
+std::string tokens(Lexer &lexer, const char *string) {
+    std::string result;
+    lexer.reset(string);
+    while (lexer.good()) {
+        lexer.advance();
+        result += std::to_string(lexer.symbol()) + ":" + lexer.lexme() + " ";
+    }
+    return result;
+}
+
+int main() {
+    // the patterns are parsed into temporaries, the generator must keep them alive
+    for (int threads : {1, 4}) {
+        Lexer lexer;
+        lexer.set_whitespace("[ \\t\\n]+");
+        lexer.add_pattern("if");
+        lexer.add_pattern("[0-9]+");
+        lexer.add_pattern("[a-z]+");
+        lexer.generate_states(threads);
+        CHECK(tokens(lexer, "abc 123 if x1") == "2:abc 1:123 0:if 2:x 1:1 ");
+    }
+    return test_failures != 0;
+}
@@ -0,0 +1,19 @@
+//
+// Created by Alex
+//
+
+#ifndef ALEX_LIBS_TEST_H
+#define ALEX_LIBS_TEST_H
+
+#include <iostream>
+
+static int test_failures = 0;
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #expr ") failed" << std::endl; \
+            test_failures++; \
+        } \
+    } while (0)
+
+#endif //ALEX_LIBS_TEST_H